@@ -0,0 +1,301 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "BRMeshRefine.H"
+#include "CFRegion.H"
+#include "HelmholtzAMRLevelOp.H"
+#include "LoadBalance.H"
+
+#include "UsingNamespace.H"
+
+/// Compares define and apply time of CoarseFineInterp against the
+/// compiled CompiledCFInterp tables for the coarse-fine fills of a
+/// two-level hierarchy, with the fine level inside the domain and
+/// against its walls.  The tables are probed from the CoarseFineInterp
+/// and do not replace its define in an AMR solve, where the coarser
+/// level's reflux needs it: the compiled define is timed with an empty
+/// stencil cache, as after a regrid to new geometry, and from the
+/// cache, on a fresh operator over the same grids.  Both fills must
+/// agree to round-off, homogeneous and inhomogeneous, on random data,
+/// and be exact for cell averages of a polynomial of degree Order.
+/// Usage: cfInterpBench [coarseSize [maxBoxSize [nApply]]]
+/// coarseSize must exceed s_minCoarsestDomainSize, below which the
+/// operator has no coarse-fine interpolation.
+
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+static void makeGrids(DisjointBoxLayout& a_grids,
+                      const Box&         a_region,
+                      const ProblemDomain& a_domain,
+                      const int          a_maxBoxSize)
+{
+  Vector<Box> boxes;
+  domainSplit(a_region, boxes, a_maxBoxSize);
+  Vector<int> procs;
+  LoadBalance(procs, boxes);
+  a_grids.define(boxes, procs, a_domain);
+}
+
+/// average of (sum_d x_d/(d+1) + 0.2)^a_degree over cell a_iv of width a_h
+static Real polyAverage(const IntVect& a_iv, const Real a_h, const int a_degree)
+{
+  const Real node[3]   = {-std::sqrt(0.6), 0.0, std::sqrt(0.6)};
+  const Real weight[3] = {5.0/18, 8.0/18, 5.0/18};
+  Box nodes(IntVect::Zero, 2*IntVect::Unit);
+  Real sum = 0;
+  for (BoxIterator bit(nodes); bit.ok(); ++bit)
+    {
+      Real w = 1;
+      Real lin = 0.2;
+      for (int d = 0; d < SpaceDim; d++)
+        {
+          w *= weight[bit()[d]];
+          lin += (a_iv[d] + 0.5 + 0.5*node[bit()[d]])*a_h/(d+1);
+        }
+      sum += w*std::pow(lin, a_degree);
+    }
+  return sum;
+}
+
+template<int Order>
+class CFBenchOp : public HelmholtzAMRLevelOp<FArrayBox, Order>
+{
+public:
+  typedef HelmholtzAMRLevelOp<FArrayBox, Order> Op;
+
+  /// the CoarseFineInterp define of the AMR define, and of the reflux
+  double defineOriginal()
+  {
+    double t0 = wallTime();
+    this->defineCFI();
+    return wallTime() - t0;
+  }
+
+  /// the s_cfInterpMode 1 define of the tables
+  double compile(const DisjointBoxLayout& a_grids,
+                 const DisjointBoxLayout& a_crsGrids,
+                 const int                a_refRatio,
+                 bool&                    a_compiled)
+  {
+    double t0 = wallTime();
+    a_compiled = this->compileCFInterp(a_grids, a_crsGrids, a_refRatio,
+                                       typename Op::CellTag());
+    return wallTime() - t0;
+  }
+
+  /// the CoarseFineInterp fill; homogeneous if a_crs is NULL
+  void fillOriginal(LevelData<FArrayBox>&       a_phi,
+                    const LevelData<FArrayBox>* a_crs)
+  {
+    if (a_crs == NULL)
+      this->fillCoarseFineGhostsHomo(a_phi);
+    else
+      this->fillCoarseFineGhostsNonHomo(a_phi, *a_crs);
+  }
+
+  bool fillCompiled(LevelData<FArrayBox>&       a_phi,
+                    const LevelData<FArrayBox>* a_crs)
+  {
+    return this->m_compiledCF.apply(a_phi, a_crs);
+  }
+};
+
+/// fine data with polynomial averages on valid cells and a_ghostVal on ghosts
+static void fillFine(LevelData<FArrayBox>& a_phi,
+                     const Real            a_h,
+                     const int             a_degree,
+                     const Real            a_ghostVal)
+{
+  const DisjointBoxLayout& grids = a_phi.disjointBoxLayout();
+  for (DataIterator dit = a_phi.dataIterator(); dit.ok(); ++dit)
+    {
+      a_phi[dit].setVal(a_ghostVal);
+      for (BoxIterator bit(grids[dit]); bit.ok(); ++bit)
+        a_phi[dit](bit(), 0) = polyAverage(bit(), a_h, a_degree);
+    }
+}
+
+/// pseudo-random data on all cells of a_phi, ghosts included
+static void fillRandom(LevelData<FArrayBox>& a_phi, const unsigned a_seed)
+{
+  for (DataIterator dit = a_phi.dataIterator(); dit.ok(); ++dit)
+    for (BoxIterator bit(a_phi[dit].box()); bit.ok(); ++bit)
+      {
+        unsigned h = 2654435761u*(a_seed + 1);
+        for (int d = 0; d < SpaceDim; d++)
+          h = (h ^ (unsigned) (bit()[d] + 4096))*16777619u;
+        a_phi[dit](bit(), 0) = (h >> 8)/16777216.0;
+      }
+}
+
+/// max difference of a_1 and a_2 over all cells, ghosts included
+static Real maxDiff(const LevelData<FArrayBox>& a_1,
+                    const LevelData<FArrayBox>& a_2)
+{
+  Real diff = 0;
+  for (DataIterator dit = a_1.dataIterator(); dit.ok(); ++dit)
+    for (BoxIterator bit(a_1[dit].box()); bit.ok(); ++bit)
+      diff = Max(diff, Abs(a_1[dit](bit(), 0) - a_2[dit](bit(), 0)));
+#ifdef CH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &diff, 1, MPI_CH_REAL, MPI_MAX,
+                Chombo_MPI::comm);
+#endif
+  return diff;
+}
+
+/// max error on the face ghosts of a_phi not covered by its layout
+static Real ghostError(const LevelData<FArrayBox>& a_phi,
+                       const ProblemDomain&        a_domain,
+                       const Real                  a_h,
+                       const int                   a_degree)
+{
+  const DisjointBoxLayout& grids = a_phi.disjointBoxLayout();
+  const int nGhosts = a_phi.ghostVect()[0];
+  Real err = 0;
+  for (DataIterator dit = a_phi.dataIterator(); dit.ok(); ++dit)
+    for (int d = 0; d < SpaceDim; d++)
+      for (int side = 0; side < 2; side++)
+        {
+          const Box& b = grids[dit];
+          Box ghosts = (side == 0 ? adjCellLo(b, d, nGhosts)
+                        : adjCellHi(b, d, nGhosts));
+          ghosts &= a_domain;
+          for (BoxIterator bit(ghosts); bit.ok(); ++bit)
+            {
+              bool covered = false;
+              for (LayoutIterator lit = grids.layoutIterator(); lit.ok(); ++lit)
+                covered = covered || grids[lit].contains(bit());
+              if (!covered)
+                err = Max(err, Abs(a_phi[dit](bit(), 0)
+                                   - polyAverage(bit(), a_h, a_degree)));
+            }
+        }
+#ifdef CH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_CH_REAL, MPI_MAX,
+                Chombo_MPI::comm);
+#endif
+  return err;
+}
+
+template<int Order>
+static int run(const char* a_name,
+               const bool  a_atWall,
+               const int   a_crsSize,
+               const int   a_maxBoxSize,
+               const int   a_nApply)
+{
+  typedef CFBenchOp<Order> BenchOp;
+  const int ref = 2;
+  const int nGhosts = BenchOp::Op::s_nGhosts;
+
+  ProblemDomain crsDomain(Box(IntVect::Zero, (a_crsSize-1)*IntVect::Unit));
+  ProblemDomain fineDomain = refine(crsDomain, ref);
+  DisjointBoxLayout crsGrids, fineGrids;
+  makeGrids(crsGrids, crsDomain.domainBox(), crsDomain, a_maxBoxSize);
+  // refine the middle half of the coarse domain, or its low corner
+  Box crsRegion = (a_atWall ?
+                   Box(IntVect::Zero, (a_crsSize/2-1)*IntVect::Unit) :
+                   grow(crsDomain.domainBox(), -a_crsSize/4));
+  makeGrids(fineGrids, refine(crsRegion, ref), fineDomain, a_maxBoxSize);
+
+  Copier exchange;
+  exchange.exchangeDefine(fineGrids, nGhosts*IntVect::Unit);
+  CFRegion cfRegion(fineGrids, fineDomain);
+  RefCountedPtr<BoundaryConditionBase> bc;
+
+  BenchOp op, freshOp;
+  const Real dx = 1.0/(ref*a_crsSize);
+  op.define(fineGrids, NULL, &crsGrids, dx, ref, 1, fineDomain, bc,
+            exchange, cfRegion, 1);
+  freshOp.define(fineGrids, NULL, &crsGrids, dx, ref, 1, fineDomain, bc,
+                 exchange, cfRegion, 1);
+  const double tDefine = op.defineOriginal();
+  CompiledCFInterp<FArrayBox>::clearCache();
+  bool compiled, recompiled;
+  const double tCompile = op.compile(fineGrids, crsGrids, ref, compiled);
+  const double tRecompile = freshOp.compile(fineGrids, crsGrids, ref,
+                                            recompiled);
+  compiled = compiled && recompiled;
+
+  LevelData<FArrayBox> phiA(fineGrids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> phiB(fineGrids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> crs(crsGrids, 1, nGhosts*IntVect::Unit);
+
+  // round-off agreement on random data, homogeneous then inhomogeneous
+  Real diff = 0;
+  for (int homo = 1; homo >= 0; homo--)
+    {
+      const LevelData<FArrayBox>* crsPtr = (homo ? NULL : &crs);
+      fillRandom(phiA, 1);
+      fillRandom(phiB, 1);
+      fillRandom(crs, 2);
+      op.fillOriginal(phiA, crsPtr);
+      compiled = freshOp.fillCompiled(phiB, crsPtr) && compiled;
+      diff = Max(diff, maxDiff(phiA, phiB));
+    }
+
+  const Real sentinel = 1.0e30;
+  fillFine(phiA, dx, Order, sentinel);
+  fillFine(phiB, dx, Order, sentinel);
+  for (DataIterator dit = crs.dataIterator(); dit.ok(); ++dit)
+    for (BoxIterator bit(crsGrids[dit]); bit.ok(); ++bit)
+      crs[dit](bit(), 0) = polyAverage(bit(), ref*dx, Order);
+
+  double t0 = wallTime();
+  for (int i = 0; i < a_nApply; i++)
+    op.fillOriginal(phiA, &crs);
+  const double tOriginal = (wallTime() - t0)/a_nApply;
+
+  t0 = wallTime();
+  for (int i = 0; i < a_nApply; i++)
+    compiled = op.fillCompiled(phiB, &crs) && compiled;
+  const double tCompiled = (wallTime() - t0)/a_nApply;
+
+  const Real errOriginal = ghostError(phiA, fineDomain, dx, Order);
+  const Real errCompiled = ghostError(phiB, fineDomain, dx, Order);
+
+  if (procID() == 0)
+    {
+      std::printf("order %d %-8s boxes %d define: CoarseFineInterp %.3e s, "
+                  "compiled %.3e s, compiled from cache %.3e s%s\n",
+                  Order, a_name, fineGrids.size(), tDefine, tCompile,
+                  tRecompile, compiled ? "" : " (not compiled)");
+      std::printf("order %d %-8s apply: CoarseFineInterp %.3e s, "
+                  "compiled %.3e s, speedup %.2f; max difference %.3e; "
+                  "polynomial error CoarseFineInterp %.3e, compiled %.3e\n",
+                  Order, a_name, tOriginal, tCompiled, tOriginal/tCompiled,
+                  diff, errOriginal, errCompiled);
+    }
+  return (compiled && diff < 1.0e-12 && errCompiled < 1.0e-9) ? 0 : 1;
+}
+
+int main(int a_argc, char* a_argv[])
+{
+#ifdef CH_MPI
+  MPI_Init(&a_argc, &a_argv);
+#endif
+  const int crsSize    = (a_argc > 1 ? std::atoi(a_argv[1]) : 32);
+  const int maxBoxSize = (a_argc > 2 ? std::atoi(a_argv[2]) : 16);
+  const int nApply     = (a_argc > 3 ? std::atoi(a_argv[3]) : 10);
+  if (crsSize <= CFBenchOp<2>::Op::s_minCoarsestDomainSize)
+    {
+      std::printf("cfInterpBench: coarseSize must exceed %d\n",
+                  CFBenchOp<2>::Op::s_minCoarsestDomainSize);
+      return 1;
+    }
+  int status = run<2>("interior", false, crsSize, maxBoxSize, nApply);
+  status |= run<2>("wall", true, crsSize, maxBoxSize, nApply);
+  status |= run<4>("interior", false, crsSize, maxBoxSize, nApply);
+  status |= run<4>("wall", true, crsSize, maxBoxSize, nApply);
+#ifdef CH_MPI
+  MPI_Finalize();
+#endif
+  return status;
+}
@@ -0,0 +1,548 @@
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "AMRMultiGrid.H"
+#include "BiCGStabSolver.H"
+#include "BRMeshRefine.H"
+#include "BoxOverlapIndex.H"
+#include "CFRegion.H"
+#include "HelmholtzAMRLevelOp.H"
+#include "LoadBalance.H"
+
+#include "BenchBC.H"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "UsingNamespace.H"
+
+/// Times the hot paths of HelmholtzAMRLevelOp on a synthetic periodic
+/// AMR hierarchy and writes one CSV row per (level, path): seconds per
+/// call, nominal bytes and flops per call, cells/s and the fraction of
+/// the STREAM-triad bandwidth measured on the same node.  Level l+1
+/// refines the middle half of level l.  Bytes are the compulsory
+/// traffic without write-allocate, as in HelmholtzKernel::bytesPerCell.
+/// The compile-time modes of the operator are part of every row, so
+/// files from different builds can be compared directly.
+/// Usage: helmholtzBench [crsSize [maxBoxSize [refRatio [nLevels
+///                       [order [nIter [file.csv]]]]]]]
+/// order 0 runs both 2 and 4; the default output is stdout.
+
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+/// slowest rank's elapsed time since a_t0
+static double elapsed(const double a_t0)
+{
+  double t = wallTime() - a_t0;
+#ifdef CH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, Chombo_MPI::comm);
+#endif
+  return t;
+}
+
+static void barrier()
+{
+#ifdef CH_MPI
+  MPI_Barrier(Chombo_MPI::comm);
+#endif
+}
+
+static int numThreads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+/// best-of-5 STREAM triad bandwidth of the node, in bytes/s, summed
+/// over the ranks running concurrently
+static double streamBandwidth()
+{
+  const long n = 1L << 24;
+  Real* a = new Real[n];
+  Real* b = new Real[n];
+  Real* c = new Real[n];
+  HELMHOLTZ_OMP(omp parallel for)
+  for (long i = 0; i < n; i++)
+    {
+      a[i] = 0;
+      b[i] = 1;
+      c[i] = 2;
+    }
+  double best = 0;
+  for (int rep = 0; rep < 5; rep++)
+    {
+      barrier();
+      const double t0 = wallTime();
+      HELMHOLTZ_OMP(omp parallel for)
+      for (long i = 0; i < n; i++)
+        a[i] = b[i] + 3*c[i];
+      const double t = wallTime() - t0;
+      best = Max(best, 3*n*sizeof(Real)/t);
+    }
+  delete[] a;
+  delete[] b;
+  delete[] c;
+#ifdef CH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &best, 1, MPI_DOUBLE, MPI_SUM,
+                Chombo_MPI::comm);
+#endif
+  return best;
+}
+
+static void makeGrids(DisjointBoxLayout&   a_grids,
+                      const Box&           a_region,
+                      const ProblemDomain& a_domain,
+                      const int            a_maxBoxSize)
+{
+  Vector<Box> boxes;
+  domainSplit(a_region, boxes, a_maxBoxSize);
+  Vector<int> procs;
+  LoadBalance(procs, boxes);
+  a_grids.define(boxes, procs, a_domain);
+}
+
+/// cells in the a_width-deep shell around the union of a_grids
+/// that lie inside the domain, i.e. coarse-fine ghosts or faces
+static long cfShellCells(const DisjointBoxLayout& a_grids,
+                         const ProblemDomain&     a_domain,
+                         const int                a_width)
+{
+  BoxOverlapIndex index;
+  index.define(a_grids);
+  Vector<int> hits;
+  long n = 0;
+  for (LayoutIterator lit = a_grids.layoutIterator(); lit.ok(); ++lit)
+    for (int d = 0; d < SpaceDim; d++)
+      for (int side = 0; side < 2; side++)
+        {
+          Box shell = (side == 0 ? adjCellLo(a_grids[lit], d, a_width)
+                                 : adjCellHi(a_grids[lit], d, a_width));
+          shell &= a_domain;
+          if (shell.isEmpty())
+            continue;
+          n += shell.numPts();
+          index.overlaps(hits, shell);
+          for (int i = 0; i < hits.size(); i++)
+            {
+              Box covered(index.box(hits[i]));
+              covered &= shell;
+              n -= covered.numPts();
+            }
+        }
+  return n;
+}
+
+/// exposes the operator's coarse-fine fill and reflux to the benchmark
+template<int Order>
+class BenchOp : public HelmholtzAMRLevelOp<FArrayBox, Order>
+{
+public:
+  void fillCF(LevelData<FArrayBox>&       a_phi,
+              const LevelData<FArrayBox>& a_crs)
+  {
+    this->levelFillCFNonHomo(a_phi, a_crs);
+  }
+
+  /// reflux as AMROperator does it, with the finer level's CFI defined
+  void refluxFrom(const LevelData<FArrayBox>& a_phiFine,
+                  const LevelData<FArrayBox>& a_phi,
+                  LevelData<FArrayBox>&       a_residual,
+                  BenchOp<Order>*             a_finerOp)
+  {
+    this->ensureFinerCFI(a_finerOp);
+    this->reflux(a_phiFine, a_phi, a_residual, a_finerOp);
+  }
+};
+
+/// AMR and multigrid operators for the benchmark hierarchy
+template<int Order>
+class BenchOpFactory : public AMRLevelOpFactory<LevelData<FArrayBox> >
+{
+public:
+  typedef HelmholtzAMRLevelOp<FArrayBox, Order> Op;
+
+  BenchOpFactory(const Vector<DisjointBoxLayout>& a_grids,
+                 const Vector<ProblemDomain>&     a_domains,
+                 const Real                       a_dx0,
+                 const int                        a_refRatio,
+                 const Real                       a_alpha,
+                 const Real                       a_beta)
+    : m_grids(a_grids), m_domains(a_domains), m_dx0(a_dx0),
+      m_refRatio(a_refRatio), m_alpha(a_alpha), m_beta(a_beta),
+      m_bc(new PeriodicBenchBC)
+  {
+  }
+
+  virtual ~BenchOpFactory() { ; }
+
+  /// operator on level a_lev with its AMR neighbours
+  BenchOp<Order>* levelOp(const int a_lev)
+  {
+    const int top = m_grids.size() - 1;
+    Real dx = m_dx0;
+    for (int l = 0; l < a_lev; l++)
+      dx /= m_refRatio;
+    Copier exchange;
+    exchange.exchangeDefine(m_grids[a_lev], Op::s_nGhosts*IntVect::Unit);
+    CFRegion cfRegion(m_grids[a_lev], m_domains[a_lev]);
+
+    BenchOp<Order>* op = new BenchOp<Order>;
+    op->define(m_grids[a_lev],
+               (a_lev < top ? &m_grids[a_lev+1] : NULL),
+               (a_lev > 0   ? &m_grids[a_lev-1] : NULL),
+               dx, (a_lev > 0 ? m_refRatio : 1),
+               (a_lev < top ? m_refRatio : 1),
+               m_domains[a_lev], m_bc, exchange, cfRegion, 1);
+    op->setAlphaAndBeta(m_alpha, m_beta);
+    return op;
+  }
+
+  virtual AMRLevelOp<LevelData<FArrayBox> >*
+  AMRnewOp(const ProblemDomain& a_domain)
+  {
+    return levelOp(level(a_domain));
+  }
+
+  virtual MGLevelOp<LevelData<FArrayBox> >*
+  MGnewOp(const ProblemDomain& a_domain, int a_depth, bool a_homoOnly = true)
+  {
+    const int lev = level(a_domain);
+    if (!hasMGLevel(lev, a_depth))
+      return NULL;
+    Real dx = m_dx0;
+    for (int l = 0; l < lev; l++)
+      dx /= m_refRatio;
+    const int coarsening = 1 << a_depth;
+    ProblemDomain domain = coarsen(m_domains[lev], coarsening);
+    DisjointBoxLayout grids;
+    coarsen(grids, m_grids[lev], coarsening);
+    Copier exchange;
+    exchange.exchangeDefine(grids, Op::s_nGhosts*IntVect::Unit);
+    CFRegion cfRegion(grids, domain);
+
+    Op* op = new Op;
+    op->define(grids, dx*coarsening, domain, m_bc, exchange, cfRegion);
+    op->setAlphaAndBeta(m_alpha, m_beta);
+    return op;
+  }
+
+  virtual int refToFiner(const ProblemDomain& a_domain) const
+  {
+    return m_refRatio;
+  }
+
+  /**
+     Cells of the multigrid levels relaxed below AMR level a_lev in a
+     V-cycle, relative to the level's own.  AMRMultiGrid coarsens the
+     base level as far as MGnewOp allows and the finer ones only down
+     to the resolution of the next coarser AMR level.
+  */
+  double mgFactor(const int a_lev) const
+  {
+    double factor = 1;
+    for (int depth = 1; hasMGLevel(a_lev, depth); depth++)
+      {
+        if (a_lev > 0 && (1 << depth) >= m_refRatio)
+          break;
+        factor += 1.0/(double)(1 << (SpaceDim*depth));
+      }
+    return factor;
+  }
+
+protected:
+
+  /// whether MGnewOp makes an operator a_depth levels below AMR level a_lev
+  bool hasMGLevel(const int a_lev, const int a_depth) const
+  {
+    const int coarsening = 1 << a_depth;
+    if (!m_grids[a_lev].coarsenable(coarsening))
+      return false;
+    ProblemDomain domain = coarsen(m_domains[a_lev], coarsening);
+    const IntVect minSize = Op::s_minCoarsestDomainSize*IntVect::Unit;
+    return !(domain.domainBox().size() < minSize);
+  }
+
+  int level(const ProblemDomain& a_domain) const
+  {
+    for (int l = 0; l < m_domains.size(); l++)
+      if (m_domains[l].domainBox() == a_domain.domainBox())
+        return l;
+    MayDay::Error("BenchOpFactory: domain not in the hierarchy");
+    return -1;
+  }
+
+  Vector<DisjointBoxLayout> m_grids;
+  Vector<ProblemDomain>     m_domains;
+  Real                      m_dx0;
+  int                       m_refRatio;
+  Real                      m_alpha;
+  Real                      m_beta;
+  RefCountedPtr<BoundaryConditionBase> m_bc;
+};
+
+/// writes rows to a CSV file; only rank 0 writes
+class BenchReport
+{
+public:
+  BenchReport(FILE* a_out, const double a_bandwidth)
+    : m_out(a_out), m_bandwidth(a_bandwidth)
+  {
+  }
+
+  void header()
+  {
+    if (procID() != 0)
+      return;
+    std::fprintf(m_out, "order,dim,nprocs,nthreads,exchangeMode,relaxMode,"
+                 "threadMode,kernelMode,cfInterpMode,mixedPrecision,"
+                 "levels,level,path,calls,cells,secondsPerCall,"
+                 "bytesPerCall,flopsPerCall,cellsPerSecond,"
+                 "bytesPerSecond,flopsPerSecond,bandwidthFraction\n");
+  }
+
+  template<int Order>
+  void row(const int a_levels, const int a_level, const char* a_path,
+           const int a_calls, const double a_cells, const double a_seconds,
+           const double a_bytes, const double a_flops)
+  {
+    typedef HelmholtzAMRLevelOp<FArrayBox, Order> Op;
+    if (procID() != 0)
+      return;
+    std::fprintf(m_out, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%s,%d,%.0f,"
+                 "%.6e,%.6e,%.6e,",
+                 Order, SpaceDim, numProc(), numThreads(),
+                 Op::s_exchangeMode, Op::s_relaxMode, Op::s_threadMode,
+                 Op::s_kernelMode, Op::s_cfInterpMode,
+                 Op::s_mixedPrecision, a_levels, a_level, a_path, a_calls,
+                 a_cells, a_seconds, a_bytes, a_flops);
+    // rates are left empty when the time is below the timer resolution
+    const double t = a_seconds;
+    if (t > 0)
+      std::fprintf(m_out, "%.6e,%.6e,%.6e,%.4f\n", a_cells/t, a_bytes/t,
+                   a_flops/t, a_bytes/t/m_bandwidth);
+    else
+      std::fprintf(m_out, ",,,\n");
+    std::fflush(m_out);
+  }
+
+  /// the reference bandwidth itself, as a row of its own
+  void stream()
+  {
+    if (procID() != 0)
+      return;
+    std::fprintf(m_out, "0,%d,%d,%d,,,,,,,0,-1,streamTriad,5,0,,,,,"
+                 "%.6e,,1.0000\n", SpaceDim, numProc(), numThreads(),
+                 m_bandwidth);
+    std::fflush(m_out);
+  }
+
+protected:
+  FILE*  m_out;
+  double m_bandwidth;
+};
+
+static void fillRandom(LevelData<FArrayBox>& a_data)
+{
+  for (DataIterator dit = a_data.dataIterator(); dit.ok(); ++dit)
+    for (BoxIterator bit(a_data[dit].box()); bit.ok(); ++bit)
+      a_data[dit](bit(), 0) = drand48();
+}
+
+template<int Order>
+static void run(BenchReport& a_report,
+                const int    a_crsSize,
+                const int    a_maxBoxSize,
+                const int    a_refRatio,
+                const int    a_nLevels,
+                const int    a_nIter)
+{
+  typedef HelmholtzKernel<Order, SpaceDim> Kernel;
+  typedef HelmholtzAMRLevelOp<FArrayBox, Order> Op;
+  const int nGhosts = Op::s_nGhosts;
+  const Real alpha = 1.0, beta = -1.0;
+  const Real dx0 = 1.0/a_crsSize;
+  const int sz = sizeof(Real);
+
+  // periodic hierarchy; level l+1 refines the middle half of level l
+  bool periodic[SpaceDim];
+  for (int d = 0; d < SpaceDim; d++)
+    periodic[d] = true;
+  Vector<ProblemDomain> domains(a_nLevels);
+  Vector<DisjointBoxLayout> grids(a_nLevels);
+  domains[0] = ProblemDomain(Box(IntVect::Zero,
+                                 (a_crsSize-1)*IntVect::Unit), periodic);
+  Box region = domains[0].domainBox();
+  for (int l = 0; l < a_nLevels; l++)
+    {
+      if (l > 0)
+        {
+          domains[l] = refine(domains[l-1], a_refRatio);
+          region = refine(grow(region, -region.size(0)/4), a_refRatio);
+        }
+      makeGrids(grids[l], region, domains[l], a_maxBoxSize);
+    }
+
+  BenchOpFactory<Order> factory(grids, domains, dx0, a_refRatio,
+                                alpha, beta);
+  Vector<BenchOp<Order>*> ops(a_nLevels);
+  Vector<LevelData<FArrayBox>*> phi(a_nLevels), rhs(a_nLevels);
+  Vector<LevelData<FArrayBox>*> lhs(a_nLevels);
+  for (int l = 0; l < a_nLevels; l++)
+    {
+      ops[l] = factory.levelOp(l);
+      phi[l] = new LevelData<FArrayBox>(grids[l], 1, nGhosts*IntVect::Unit);
+      rhs[l] = new LevelData<FArrayBox>(grids[l], 1, IntVect::Zero);
+      lhs[l] = new LevelData<FArrayBox>(grids[l], 1, IntVect::Zero);
+      fillRandom(*phi[l]);
+      fillRandom(*rhs[l]);
+    }
+
+  const int nLev = a_nLevels;
+  double vcycleCells = 0, vcycleBytes = 0, vcycleFlops = 0;
+  const int nPre = 2, nPost = 2;
+  for (int l = 0; l < nLev; l++)
+    {
+      BenchOp<Order>& op = *ops[l];
+      const double cells = (double)grids[l].numCells();
+
+      // the op's first call may allocate scratch data: warm up untimed
+      op.applyOp(*lhs[l], *phi[l]);
+      barrier();
+      double t0 = wallTime();
+      for (int it = 0; it < a_nIter; it++)
+        op.applyOp(*lhs[l], *phi[l]);
+      a_report.row<Order>(nLev, l, "applyOp", a_nIter, cells,
+                          elapsed(t0)/a_nIter,
+                          cells*Kernel::bytesPerCell(Kernel::Apply),
+                          cells*Kernel::flopsPerCell(Kernel::Apply));
+
+      op.residual(*lhs[l], *phi[l], *rhs[l]);
+      barrier();
+      t0 = wallTime();
+      for (int it = 0; it < a_nIter; it++)
+        op.residual(*lhs[l], *phi[l], *rhs[l]);
+      a_report.row<Order>(nLev, l, "residual", a_nIter, cells,
+                          elapsed(t0)/a_nIter,
+                          cells*Kernel::bytesPerCell(Kernel::Residual),
+                          cells*Kernel::flopsPerCell(Kernel::Residual));
+
+      // one sweep per call, modelled as point Jacobi
+      op.relax(*phi[l], *rhs[l], 1);
+      barrier();
+      t0 = wallTime();
+      for (int it = 0; it < a_nIter; it++)
+        op.relax(*phi[l], *rhs[l], 1);
+      a_report.row<Order>(nLev, l, "relax", a_nIter, cells,
+                          elapsed(t0)/a_nIter,
+                          cells*Kernel::bytesPerCell(Kernel::Jacobi),
+                          cells*Kernel::flopsPerCell(Kernel::Jacobi));
+
+      if (l > 0)
+        {
+          // one write and one source read per coarse-fine ghost
+          const double ghosts = cfShellCells(grids[l], domains[l], nGhosts);
+          op.fillCF(*phi[l], *phi[l-1]);
+          barrier();
+          t0 = wallTime();
+          for (int it = 0; it < a_nIter; it++)
+            op.fillCF(*phi[l], *phi[l-1]);
+          a_report.row<Order>(nLev, l, "cfFill", a_nIter, ghosts,
+                              elapsed(t0)/a_nIter, 2*ghosts*sz, 0);
+        }
+
+      if (l < nLev - 1)
+        {
+          // per fine coarse-fine face: the flux stencil, the flux and
+          // the coarse cell it is added to
+          const double faces = cfShellCells(grids[l+1], domains[l+1], 1);
+          const double perFace = (Order==4 ? 6 : 3);
+          op.refluxFrom(*phi[l+1], *phi[l], *lhs[l], ops[l+1]);
+          barrier();
+          t0 = wallTime();
+          for (int it = 0; it < a_nIter; it++)
+            op.refluxFrom(*phi[l+1], *phi[l], *lhs[l], ops[l+1]);
+          a_report.row<Order>(nLev, l, "reflux", a_nIter, faces,
+                              elapsed(t0)/a_nIter,
+                              faces*(Order + 3)*sz, faces*perFace);
+        }
+
+      // the multigrid levels below this one, without the bottom solve
+      const double mgFactor = factory.mgFactor(l);
+      vcycleCells += cells;
+      vcycleBytes += cells*mgFactor
+        *((nPre + nPost)*Kernel::bytesPerCell(Kernel::Jacobi)
+          + 2*Kernel::bytesPerCell(Kernel::Residual));
+      vcycleFlops += cells*mgFactor
+        *((nPre + nPost)*Kernel::flopsPerCell(Kernel::Jacobi)
+          + 2*Kernel::flopsPerCell(Kernel::Residual));
+    }
+
+  // full V-cycles: one iteration per solve call, which also includes
+  // AMRMultiGrid's initial residual norm
+  BiCGStabSolver<LevelData<FArrayBox> > bottom;
+  bottom.m_verbosity = 0;
+  AMRMultiGrid<LevelData<FArrayBox> > solver;
+  solver.define(domains[0], factory, &bottom, nLev);
+  solver.setSolverParameters(nPre, nPost, 8, 1, 1, 1.0e-300, 0.0, 0.0);
+  solver.m_verbosity = 0;
+  solver.solve(phi, rhs, nLev-1, 0, true);
+  barrier();
+  double t0 = wallTime();
+  for (int it = 0; it < a_nIter; it++)
+    solver.solve(phi, rhs, nLev-1, 0, false);
+  a_report.row<Order>(nLev, -1, "vcycle", a_nIter, vcycleCells,
+                      elapsed(t0)/a_nIter, vcycleBytes, vcycleFlops);
+
+  for (int l = 0; l < nLev; l++)
+    {
+      delete ops[l];
+      delete phi[l];
+      delete rhs[l];
+      delete lhs[l];
+    }
+}
+
+int main(int a_argc, char* a_argv[])
+{
+#ifdef CH_MPI
+  MPI_Init(&a_argc, &a_argv);
+#endif
+  const int crsSize    = (a_argc > 1 ? std::atoi(a_argv[1]) : 32);
+  const int maxBoxSize = (a_argc > 2 ? std::atoi(a_argv[2]) : 16);
+  const int refRatio   = (a_argc > 3 ? std::atoi(a_argv[3]) : 2);
+  const int nLevels    = (a_argc > 4 ? std::atoi(a_argv[4]) : 2);
+  const int order      = (a_argc > 5 ? std::atoi(a_argv[5]) : 0);
+  const int nIter      = (a_argc > 6 ? std::atoi(a_argv[6]) : 10);
+  FILE* out = stdout;
+  if (a_argc > 7 && procID() == 0)
+    {
+      out = std::fopen(a_argv[7], "w");
+      if (out == NULL)
+        MayDay::Error("helmholtzBench: cannot open the output file");
+    }
+
+  BenchReport report(out, streamBandwidth());
+  report.header();
+  report.stream();
+  if (order == 0 || order == 2)
+    run<2>(report, crsSize, maxBoxSize, refRatio, nLevels, nIter);
+  if (order == 0 || order == 4)
+    run<4>(report, crsSize, maxBoxSize, refRatio, nLevels, nIter);
+
+  if (out != stdout)
+    std::fclose(out);
+#ifdef CH_MPI
+  MPI_Finalize();
+#endif
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "BRMeshRefine.H"
+#include "CFRegion.H"
+#include "FArrayBox.H"
+#include "HelmholtzAMRLevelOp.H"
+#include "HelmholtzAMRLevelOpF_F.H"
+#include "HelmholtzKernels.H"
+#include "LoadBalance.H"
+
+#include "BenchBC.H"
+
+#include "UsingNamespace.H"
+
+/// Checks HelmholtzKernel against the Fortran flux kernels, checks the
+/// kernel paths of applyOpI, residualI and levelJacobi against the
+/// Fortran operator on periodic and walled domains, and times the fused
+/// stencils.  Usage: kernelBench [boxSize [nIter]]
+
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+static void fillRandom(FArrayBox& a_fab)
+{
+  Real* p = a_fab.dataPtr();
+  const long n = a_fab.box().numPts()*a_fab.nComp();
+  for (long i = 0; i < n; i++)
+    p[i] = drand48();
+}
+
+/// exposes the Fortran and the C++ kernel paths of the level operators
+template<int Order>
+class KernelBenchOp : public HelmholtzAMRLevelOp<FArrayBox, Order>
+{
+public:
+
+  /// largest difference of apply, residual and one Jacobi sweep between
+  /// the two paths, relative to the largest Fortran value
+  Real checkKernels(const LevelData<FArrayBox>& a_phi,
+                    const LevelData<FArrayBox>& a_rhs)
+  {
+    const DisjointBoxLayout& grids = a_phi.disjointBoxLayout();
+    const int ncomp = a_phi.nComp();
+    const IntVect ghostVect = a_phi.ghostVect();
+    LevelData<FArrayBox> phi(grids, ncomp, ghostVect);
+    LevelData<FArrayBox> phiKernel(grids, ncomp, ghostVect);
+    LevelData<FArrayBox> out(grids, ncomp, IntVect::Zero);
+    LevelData<FArrayBox> outKernel(grids, ncomp, IntVect::Zero);
+    Real diff = 0;
+    Real scale = 0;
+
+    copyValid(phi, a_phi);
+    this->applyOpI(out, phi, true);
+    this->applyOpIKernel(outKernel, phi, true);
+    accumulate(diff, scale, out, outKernel);
+
+    this->residualI(out, phi, a_rhs, true);
+    this->residualIKernel(outKernel, phi, a_rhs, true);
+    accumulate(diff, scale, out, outKernel);
+
+    copyValid(phiKernel, a_phi);
+    this->cacheOpDiag(phi);
+    this->levelJacobi(phi, a_rhs);
+    this->levelJacobiKernel(phiKernel, a_rhs);
+    accumulate(diff, scale, phi, phiKernel);
+
+#ifdef CH_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &diff, 1, MPI_CH_REAL, MPI_MAX,
+                  Chombo_MPI::comm);
+    MPI_Allreduce(MPI_IN_PLACE, &scale, 1, MPI_CH_REAL, MPI_MAX,
+                  Chombo_MPI::comm);
+#endif
+    return diff/Max(scale, (Real)1.0);
+  }
+
+protected:
+
+  static void copyValid(LevelData<FArrayBox>&       a_dst,
+                        const LevelData<FArrayBox>& a_src)
+  {
+    for (DataIterator dit = a_dst.dataIterator(); dit.ok(); ++dit)
+      a_dst[dit].copy(a_src[dit]);
+  }
+
+  /// max |a_ref - a_test| and max |a_ref| over valid cells
+  static void accumulate(Real&                       a_diff,
+                         Real&                       a_scale,
+                         const LevelData<FArrayBox>& a_ref,
+                         const LevelData<FArrayBox>& a_test)
+  {
+    const DisjointBoxLayout& dbl = a_ref.disjointBoxLayout();
+    for (DataIterator dit = a_ref.dataIterator(); dit.ok(); ++dit)
+      for (int c = 0; c < a_ref.nComp(); c++)
+        for (BoxIterator bit(dbl[dit]); bit.ok(); ++bit)
+          {
+            const Real r = a_ref[dit](bit(), c);
+            a_diff = Max(a_diff, Abs(r - a_test[dit](bit(), c)));
+            a_scale = Max(a_scale, Abs(r));
+          }
+  }
+};
+
+/// kernel paths against the Fortran operator on a domain of a_boxSize
+/// cells split into boxes of a_boxSize/2
+template<int Order>
+static int checkOperator(const char* a_name,
+                         const bool  a_periodic,
+                         const int   a_boxSize)
+{
+  typedef KernelBenchOp<Order> BenchOp;
+  const int nGhosts = Order/2;
+
+  bool periodic[SpaceDim];
+  for (int d = 0; d < SpaceDim; d++)
+    periodic[d] = a_periodic;
+  ProblemDomain domain(Box(IntVect::Zero, (a_boxSize-1)*IntVect::Unit),
+                       periodic);
+  Vector<Box> boxes;
+  domainSplit(domain.domainBox(), boxes, Max(a_boxSize/2, 2*nGhosts));
+  Vector<int> procs;
+  LoadBalance(procs, boxes);
+  DisjointBoxLayout grids(boxes, procs, domain);
+
+  Copier exchange;
+  exchange.exchangeDefine(grids, nGhosts*IntVect::Unit);
+  CFRegion cfRegion(grids, domain);
+  RefCountedPtr<BoundaryConditionBase> bc(new ReflectBenchBC(domain));
+  BenchOp op;
+  op.define(grids, 1.0/a_boxSize, domain, bc, exchange, cfRegion);
+  op.setAlphaAndBeta(1.0, -1.0);
+
+  LevelData<FArrayBox> phi(grids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> rhs(grids, 1, IntVect::Zero);
+  for (DataIterator dit = grids.dataIterator(); dit.ok(); ++dit)
+    {
+      fillRandom(phi[dit]);
+      fillRandom(rhs[dit]);
+    }
+  const Real err = op.checkKernels(phi, rhs);
+  if (procID() == 0)
+    std::printf("order %d %-8s operator relative difference %g\n",
+                Order, a_name, err);
+  return (err > 1.0e-12 ? 1 : 0);
+}
+
+template<int Order>
+static int run(const int a_boxSize, const int a_nIter)
+{
+  typedef HelmholtzKernel<Order, SpaceDim> Kernel;
+  const int nGhosts = Order/2;
+  const Real alpha = 1.0, beta = -1.0, dx = 1.0/a_boxSize;
+
+  Box valid(IntVect::Zero, (a_boxSize-1)*IntVect::Unit);
+  FArrayBox phi(grow(valid, nGhosts), 1);
+  FArrayBox rhs(valid, 1), diag(valid, 1), out(valid, 1);
+  fillRandom(phi);
+  fillRandom(rhs);
+  diag.setVal(alpha - 30*SpaceDim*beta/12.0/(dx*dx));
+
+  // fluxes against the Fortran kernels
+  int status = 0;
+  const Real scale = beta/dx;
+  for (int dir = 0; dir < SpaceDim; dir++)
+    {
+      Box edgebox = surroundingNodes(phi.box(), dir);
+      edgebox.grow(dir, -nGhosts);
+      FArrayBox fluxF(edgebox, 1), fluxC(edgebox, 1);
+      if (Order==4)
+        FORT_REFLUXGETFLUX4(CHF_FRA(fluxF), CHF_CONST_FRA(phi),
+                            CHF_BOX(edgebox), CHF_CONST_REAL(scale),
+                            CHF_CONST_INT(dir));
+      else
+        FORT_REFLUXGETFLUX2(CHF_FRA(fluxF), CHF_CONST_FRA(phi),
+                            CHF_BOX(edgebox), CHF_CONST_REAL(scale),
+                            CHF_CONST_INT(dir));
+      Kernel::flux(fluxC, phi, edgebox, scale, dir);
+      fluxC -= fluxF;
+      const Real err = fluxC.norm(0)/Max(fluxF.norm(0), (Real)1.0);
+      if (procID() == 0)
+        std::printf("order %d dir %d flux relative difference %g\n",
+                    Order, dir, err);
+      if (err > 1.0e-12)
+        status = 1;
+    }
+  status |= checkOperator<Order>("periodic", true, a_boxSize);
+  status |= checkOperator<Order>("wall", false, a_boxSize);
+
+  const char* names[3] = {"apply", "residual", "jacobi"};
+  const double cells = (double)valid.numPts();
+  for (int op = 0; op < 3; op++)
+    {
+      double t0 = wallTime();
+      for (int it = 0; it < a_nIter; it++)
+        Kernel::stencil(op, out, 0, phi, 0, &rhs, 0, &diag, 0, true,
+                        valid, 1, alpha, beta, dx);
+      const double t = (wallTime() - t0)/a_nIter;
+      if (procID() == 0)
+        std::printf("order %d %-8s %10.3e s/call %8.3f Gcells/s "
+                    "%3d bytes/cell %6.2f GB/s\n",
+                    Order, names[op], t, cells/t*1.0e-9,
+                    Kernel::bytesPerCell(op),
+                    cells*Kernel::bytesPerCell(op)/t*1.0e-9);
+    }
+  return status;
+}
+
+int main(int a_argc, char* a_argv[])
+{
+#ifdef CH_MPI
+  MPI_Init(&a_argc, &a_argv);
+#endif
+  const int boxSize = (a_argc > 1 ? std::atoi(a_argv[1]) : 64);
+  const int nIter   = (a_argc > 2 ? std::atoi(a_argv[2]) : 20);
+  int status = run<2>(boxSize, nIter);
+  status |= run<4>(boxSize, nIter);
+#ifdef CH_MPI
+  MPI_Finalize();
+#endif
+  return status;
+}
@@ -0,0 +1,268 @@
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "BRMeshRefine.H"
+#include "CFRegion.H"
+#include "HelmholtzAMRLevelOp.H"
+#include "LoadBalance.H"
+
+#include "BenchBC.H"
+
+#include "UsingNamespace.H"
+
+/// Checks the float point Jacobi of s_mixedPrecision 1 against double
+/// kernel sweeps and times both.  A defect correction, residuals in
+/// double and corrections smoothed in float or in double as multigrid
+/// smooths its coarse levels, must reach the same tolerance in about
+/// as many steps either way.  Runs on a periodic domain, on a channel
+/// periodic in x only, on walled domains with boxes of the ghost depth
+/// and wider, and with boundary conditions that vary along the walls,
+/// which do not compile to wall weights and go through double data.
+/// The mesh spacing is 1 and alpha large enough for Jacobi to converge.
+/// Usage: mixedPrecisionBench [domainSize [maxBoxSize [nIter]]]
+
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+/// ReflectBenchBC with the ghosts scaled by their position along the wall
+class GradedBenchBC : public ReflectBenchBC
+{
+public:
+
+  GradedBenchBC(const ProblemDomain& a_domain)
+    : ReflectBenchBC(a_domain)
+  {
+  }
+
+  virtual void fillGhostCells(LevelData<FArrayBox>& a_phi,
+                              const Real            a_dx,
+                              const bool            a_homo)
+  {
+    ReflectBenchBC::fillGhostCells(a_phi, a_dx, a_homo);
+    const DisjointBoxLayout& dbl = a_phi.disjointBoxLayout();
+    const Box& domBox = m_domain.domainBox();
+    for (DataIterator dit = a_phi.dataIterator(); dit.ok(); ++dit)
+      for (int d = 0; d < SpaceDim; d++)
+        for (int side = 0; side < 2; side++)
+          {
+            const Box& b = dbl[dit];
+            const int depth = a_phi.ghostVect()[d];
+            if (m_domain.isPeriodic(d) || depth == 0 ||
+                (side == 0 && b.smallEnd(d) != domBox.smallEnd(d)) ||
+                (side == 1 && b.bigEnd(d) != domBox.bigEnd(d)))
+              continue;
+            Box ghosts = (side == 0 ? adjCellLo(b, d, depth)
+                          : adjCellHi(b, d, depth));
+            for (int c = 0; c < a_phi.nComp(); c++)
+              for (BoxIterator bit(ghosts); bit.ok(); ++bit)
+                a_phi[dit](bit(), c) *= 1.0 + 0.01*bit().sum();
+          }
+  }
+};
+
+/// exposes the float and double Jacobi sweeps of the operator
+template<int Order>
+class MixedBenchOp : public HelmholtzAMRLevelOp<FArrayBox, Order>
+{
+public:
+  typedef HelmholtzAMRLevelOp<FArrayBox, Order> Op;
+
+  void floatSweeps(LevelData<FArrayBox>&       a_phi,
+                   const LevelData<FArrayBox>& a_rhs,
+                   const int                   a_iterations)
+  {
+    this->levelJacobiFloat(a_phi, a_rhs, a_iterations);
+  }
+
+  void doubleSweeps(LevelData<FArrayBox>&       a_phi,
+                    const LevelData<FArrayBox>& a_rhs,
+                    const int                   a_iterations)
+  {
+    for (int i = 0; i < a_iterations; i++)
+      {
+        this->cacheOpDiag(a_phi);
+        this->levelJacobiKernel(a_phi, a_rhs);
+      }
+  }
+
+  bool wallsCompiled() const
+  {
+    return this->m_floatWallsCompiled;
+  }
+};
+
+static void copyValid(LevelData<FArrayBox>&       a_dst,
+                      const LevelData<FArrayBox>& a_src)
+{
+  for (DataIterator dit = a_dst.dataIterator(); dit.ok(); ++dit)
+    a_dst[dit].copy(a_src[dit]);
+}
+
+/// max |a_1 - a_2| over valid cells
+static Real maxDiff(const LevelData<FArrayBox>& a_1,
+                    const LevelData<FArrayBox>& a_2)
+{
+  const DisjointBoxLayout& dbl = a_1.disjointBoxLayout();
+  Real diff = 0;
+  for (DataIterator dit = a_1.dataIterator(); dit.ok(); ++dit)
+    for (BoxIterator bit(dbl[dit]); bit.ok(); ++bit)
+      diff = Max(diff, Abs(a_1[dit](bit(), 0) - a_2[dit](bit(), 0)));
+#ifdef CH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &diff, 1, MPI_CH_REAL, MPI_MAX,
+                Chombo_MPI::comm);
+#endif
+  return diff;
+}
+
+/**
+   Defect correction steps until the max norm of the residual is below
+   a_tol times that of a_rhs, each smoothing the correction of the
+   residual from zero with a_sweeps float or double sweeps.  Returns
+   the number of steps, or a_maxSteps+1 if it did not converge.
+*/
+template<int Order>
+static int defectCorrection(MixedBenchOp<Order>&        a_op,
+                            LevelData<FArrayBox>&       a_phi,
+                            const LevelData<FArrayBox>& a_rhs,
+                            const bool                  a_float,
+                            const int                   a_sweeps,
+                            const Real                  a_tol,
+                            const int                   a_maxSteps)
+{
+  LevelData<FArrayBox> res, corr;
+  a_op.create(res, a_rhs);
+  a_op.create(corr, a_phi);
+  a_op.setToZero(a_phi);
+  const Real rhsNorm = a_op.norm(a_rhs, 0);
+  for (int step = 0; step <= a_maxSteps; step++)
+    {
+      a_op.residual(res, a_phi, a_rhs, true);
+      if (a_op.norm(res, 0) <= a_tol*rhsNorm)
+        return step;
+      a_op.setToZero(corr);
+      if (a_float)
+        a_op.floatSweeps(corr, res, a_sweeps);
+      else
+        a_op.doubleSweeps(corr, res, a_sweeps);
+      a_op.incr(a_phi, corr, 1.0);
+    }
+  return a_maxSteps + 1;
+}
+
+template<int Order>
+static int run(const char* a_name,
+               const int   a_nPeriodic,
+               const int   a_domainSize,
+               const int   a_maxBoxSize,
+               const int   a_nIter,
+               const bool  a_graded = false)
+{
+  typedef MixedBenchOp<Order> BenchOp;
+  const int nGhosts = BenchOp::Op::s_nGhosts;
+  const int nSweeps = 4;
+  const Real tol = 1.0e-10;
+  const int maxSteps = 200;
+
+  bool periodic[SpaceDim];
+  for (int d = 0; d < SpaceDim; d++)
+    periodic[d] = (d < a_nPeriodic);
+  ProblemDomain domain(Box(IntVect::Zero, (a_domainSize-1)*IntVect::Unit),
+                       periodic);
+  Vector<Box> boxes;
+  domainSplit(domain.domainBox(), boxes, a_maxBoxSize);
+  Vector<int> procs;
+  LoadBalance(procs, boxes);
+  DisjointBoxLayout grids(boxes, procs, domain);
+
+  Copier exchange;
+  exchange.exchangeDefine(grids, nGhosts*IntVect::Unit);
+  CFRegion cfRegion(grids, domain);
+  RefCountedPtr<BoundaryConditionBase> bc(a_graded ?
+                                          new GradedBenchBC(domain) :
+                                          new ReflectBenchBC(domain));
+  BenchOp op;
+  op.define(grids, 1.0, domain, bc, exchange, cfRegion);
+  // point Jacobi on the 4th-order stencil needs the larger shift
+  op.setAlphaAndBeta(Order == 4 ? 2.0*SpaceDim : 1.0, -1.0);
+
+  LevelData<FArrayBox> rhs(grids, 1, IntVect::Zero);
+  LevelData<FArrayBox> phi0(grids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> phiFloat(grids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> phiDouble(grids, 1, nGhosts*IntVect::Unit);
+  for (DataIterator dit = grids.dataIterator(); dit.ok(); ++dit)
+    {
+      for (BoxIterator bit(phi0[dit].box()); bit.ok(); ++bit)
+        phi0[dit](bit(), 0) = drand48();
+      for (BoxIterator bit(rhs[dit].box()); bit.ok(); ++bit)
+        rhs[dit](bit(), 0) = drand48();
+    }
+
+  copyValid(phiFloat, phi0);
+  copyValid(phiDouble, phi0);
+  op.floatSweeps(phiFloat, rhs, nSweeps);
+  op.doubleSweeps(phiDouble, rhs, nSweeps);
+  const Real sweepDiff = maxDiff(phiFloat, phiDouble)
+    /op.norm(phiDouble, 0);
+
+  const int stepsFloat = defectCorrection(op, phiFloat, rhs, true,
+                                          nSweeps, tol, maxSteps);
+  const int stepsDouble = defectCorrection(op, phiDouble, rhs, false,
+                                           nSweeps, tol, maxSteps);
+
+  double t0 = wallTime();
+  for (int i = 0; i < a_nIter; i++)
+    op.floatSweeps(phiFloat, rhs, nSweeps);
+  const double tFloat = (wallTime() - t0)/(a_nIter*nSweeps);
+  t0 = wallTime();
+  for (int i = 0; i < a_nIter; i++)
+    op.doubleSweeps(phiDouble, rhs, nSweeps);
+  const double tDouble = (wallTime() - t0)/(a_nIter*nSweeps);
+
+  if (procID() == 0)
+    std::printf("order %d %-13s boxes %4d walls %s: %d sweeps differ by "
+                "%.3e; defect correction to %.0e in %d steps, %d in "
+                "double; %.3e s/sweep vs %.3e s/sweep\n",
+                Order, a_name, grids.size(),
+                op.wallsCompiled() ? "compiled" : "via double",
+                nSweeps, sweepDiff, tol, stepsFloat, stepsDouble,
+                tFloat, tDouble);
+  return (op.wallsCompiled() != a_graded && sweepDiff < 1.0e-5
+          && stepsFloat <= maxSteps && stepsFloat <= stepsDouble + 2) ? 0 : 1;
+}
+
+template<int Order>
+static int runAll(const int a_domainSize,
+                  const int a_maxBoxSize,
+                  const int a_nIter)
+{
+  int status = run<Order>("periodic", SpaceDim, a_domainSize, a_maxBoxSize,
+                          a_nIter);
+  status |= run<Order>("channel", 1, a_domainSize, a_maxBoxSize, a_nIter);
+  status |= run<Order>("wall", 0, a_domainSize, a_maxBoxSize, a_nIter);
+  status |= run<Order>("wall,thin boxes", 0, a_domainSize,
+                       MixedBenchOp<Order>::Op::s_nGhosts, a_nIter);
+  status |= run<Order>("graded wall", 0, a_domainSize, a_maxBoxSize,
+                       a_nIter, true);
+  return status;
+}
+
+int main(int a_argc, char* a_argv[])
+{
+#ifdef CH_MPI
+  MPI_Init(&a_argc, &a_argv);
+#endif
+  const int domainSize = (a_argc > 1 ? std::atoi(a_argv[1]) : 16);
+  const int maxBoxSize = (a_argc > 2 ? std::atoi(a_argv[2]) : 8);
+  const int nIter      = (a_argc > 3 ? std::atoi(a_argv[3]) : 10);
+  int status = runAll<2>(domainSize, maxBoxSize, nIter);
+  status |= runAll<4>(domainSize, maxBoxSize, nIter);
+#ifdef CH_MPI
+  MPI_Finalize();
+#endif
+  return status;
+}
@@ -0,0 +1,210 @@
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+#include "BRMeshRefine.H"
+#include "CFRegion.H"
+#include "HelmholtzAMRLevelOp.H"
+#include "LoadBalance.H"
+
+#include "BenchBC.H"
+
+#include "UsingNamespace.H"
+
+/// Checks the communication-avoiding Jacobi of s_relaxMode 2 against
+/// ordinary sweeps and times both.  Every case covers the domain, so
+/// the block sweeps must run, be bitwise identical to k
+/// levelJacobiKernel sweeps and agree with k Fortran levelJacobi sweeps
+/// to round-off.  Runs on a periodic domain, on a channel periodic in
+/// x only and on walled domains with several boxes and with one box;
+/// the multi-box walled cases exercise the boundary slabs.
+/// Usage: relaxBench [domainSize [maxBoxSize [nIter]]]
+
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+/// exposes the Jacobi variants of the operator
+template<int Order>
+class RelaxBenchOp : public HelmholtzAMRLevelOp<FArrayBox, Order>
+{
+public:
+  typedef HelmholtzAMRLevelOp<FArrayBox, Order> Op;
+
+  void blockSweeps(LevelData<FArrayBox>&       a_phi,
+                   const LevelData<FArrayBox>& a_rhs,
+                   const int                   a_iterations)
+  {
+    this->levelJacobiCA(a_phi, a_rhs, a_iterations);
+  }
+
+  void kernelSweeps(LevelData<FArrayBox>&       a_phi,
+                    const LevelData<FArrayBox>& a_rhs,
+                    const int                   a_iterations)
+  {
+    for (int i = 0; i < a_iterations; i++)
+      {
+        this->cacheOpDiag(a_phi);
+        this->levelJacobiKernel(a_phi, a_rhs);
+      }
+  }
+
+  void ordinarySweeps(LevelData<FArrayBox>&       a_phi,
+                      const LevelData<FArrayBox>& a_rhs,
+                      const int                   a_iterations)
+  {
+    for (int i = 0; i < a_iterations; i++)
+      {
+        this->cacheOpDiag(a_phi);
+        this->levelRelaxJacobi(a_phi, a_rhs);
+      }
+  }
+
+  void fortranSweeps(LevelData<FArrayBox>&       a_phi,
+                     const LevelData<FArrayBox>& a_rhs,
+                     const int                   a_iterations)
+  {
+    for (int i = 0; i < a_iterations; i++)
+      {
+        this->cacheOpDiag(a_phi);
+        this->levelJacobi(a_phi, a_rhs);
+      }
+  }
+
+  bool blockSweepsUsed(const DisjointBoxLayout& a_grids)
+  {
+    return this->caUsable(a_grids);
+  }
+};
+
+static void copyValid(LevelData<FArrayBox>&       a_dst,
+                      const LevelData<FArrayBox>& a_src)
+{
+  for (DataIterator dit = a_dst.dataIterator(); dit.ok(); ++dit)
+    a_dst[dit].copy(a_src[dit]);
+}
+
+/// max |a_1 - a_2| over valid cells
+static Real maxDiff(const LevelData<FArrayBox>& a_1,
+                    const LevelData<FArrayBox>& a_2)
+{
+  const DisjointBoxLayout& dbl = a_1.disjointBoxLayout();
+  Real diff = 0;
+  for (DataIterator dit = a_1.dataIterator(); dit.ok(); ++dit)
+    for (BoxIterator bit(dbl[dit]); bit.ok(); ++bit)
+      diff = Max(diff, Abs(a_1[dit](bit(), 0) - a_2[dit](bit(), 0)));
+#ifdef CH_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &diff, 1, MPI_CH_REAL, MPI_MAX,
+                Chombo_MPI::comm);
+#endif
+  return diff;
+}
+
+template<int Order>
+static int run(const char* a_name,
+               const int   a_nPeriodic,
+               const int   a_domainSize,
+               const int   a_maxBoxSize,
+               const int   a_nIter)
+{
+  typedef RelaxBenchOp<Order> BenchOp;
+  const int nGhosts = BenchOp::Op::s_nGhosts;
+  // leftover sweeps after the last full block
+  const int nSweeps = 2*BenchOp::Op::s_caSweeps + 1;
+
+  bool periodic[SpaceDim];
+  for (int d = 0; d < SpaceDim; d++)
+    periodic[d] = (d < a_nPeriodic);
+  ProblemDomain domain(Box(IntVect::Zero, (a_domainSize-1)*IntVect::Unit),
+                       periodic);
+  Vector<Box> boxes;
+  domainSplit(domain.domainBox(), boxes, a_maxBoxSize);
+  Vector<int> procs;
+  LoadBalance(procs, boxes);
+  DisjointBoxLayout grids(boxes, procs, domain);
+
+  Copier exchange;
+  exchange.exchangeDefine(grids, nGhosts*IntVect::Unit);
+  CFRegion cfRegion(grids, domain);
+  RefCountedPtr<BoundaryConditionBase> bc(new ReflectBenchBC(domain));
+  BenchOp op;
+  op.define(grids, 1.0/a_domainSize, domain, bc, exchange, cfRegion);
+  op.setAlphaAndBeta(1.0, -1.0);
+
+  LevelData<FArrayBox> rhs(grids, 1, IntVect::Zero);
+  LevelData<FArrayBox> phi0(grids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> phiBlock(grids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> phiRef(grids, 1, nGhosts*IntVect::Unit);
+  LevelData<FArrayBox> phiFortran(grids, 1, nGhosts*IntVect::Unit);
+  for (DataIterator dit = grids.dataIterator(); dit.ok(); ++dit)
+    {
+      for (BoxIterator bit(phi0[dit].box()); bit.ok(); ++bit)
+        phi0[dit](bit(), 0) = drand48();
+      for (BoxIterator bit(rhs[dit].box()); bit.ok(); ++bit)
+        rhs[dit](bit(), 0) = drand48();
+    }
+
+  const bool used = op.blockSweepsUsed(grids);
+  copyValid(phiBlock, phi0);
+  copyValid(phiRef, phi0);
+  copyValid(phiFortran, phi0);
+  op.blockSweeps(phiBlock, rhs, nSweeps);
+  if (used)
+    op.kernelSweeps(phiRef, rhs, nSweeps);
+  else
+    op.ordinarySweeps(phiRef, rhs, nSweeps);
+  op.fortranSweeps(phiFortran, rhs, nSweeps);
+  const Real refDiff = maxDiff(phiBlock, phiRef);
+  const Real fortranDiff = maxDiff(phiBlock, phiFortran);
+
+  double t0 = wallTime();
+  for (int i = 0; i < a_nIter; i++)
+    op.blockSweeps(phiBlock, rhs, nSweeps);
+  const double tBlock = (wallTime() - t0)/(a_nIter*nSweeps);
+  t0 = wallTime();
+  for (int i = 0; i < a_nIter; i++)
+    op.fortranSweeps(phiFortran, rhs, nSweeps);
+  const double tFortran = (wallTime() - t0)/(a_nIter*nSweeps);
+
+  if (procID() == 0)
+    std::printf("order %d %-12s boxes %3d %d sweeps: %s, "
+                "difference %.3e, vs levelJacobi %.3e; "
+                "%.3e s/sweep vs %.3e s/sweep\n",
+                Order, a_name, grids.size(), nSweeps,
+                used ? "block sweeps" : "fall back", refDiff, fortranDiff,
+                tBlock, tFortran);
+  return (used && refDiff == 0 && fortranDiff < 1.0e-10) ? 0 : 1;
+}
+
+template<int Order>
+static int runAll(const int a_domainSize,
+                  const int a_maxBoxSize,
+                  const int a_nIter)
+{
+  int status = run<Order>("periodic", SpaceDim, a_domainSize, a_maxBoxSize,
+                          a_nIter);
+  status |= run<Order>("channel", 1, a_domainSize, a_maxBoxSize, a_nIter);
+  status |= run<Order>("wall", 0, a_domainSize, a_maxBoxSize, a_nIter);
+  status |= run<Order>("wall,one box", 0, a_domainSize, a_domainSize,
+                       a_nIter);
+  return status;
+}
+
+int main(int a_argc, char* a_argv[])
+{
+#ifdef CH_MPI
+  MPI_Init(&a_argc, &a_argv);
+#endif
+  const int domainSize = (a_argc > 1 ? std::atoi(a_argv[1]) : 32);
+  const int maxBoxSize = (a_argc > 2 ? std::atoi(a_argv[2]) : 8);
+  const int nIter      = (a_argc > 3 ? std::atoi(a_argv[3]) : 4);
+  int status = runAll<2>(domainSize, maxBoxSize, nIter);
+  status |= runAll<4>(domainSize, maxBoxSize, nIter);
+#ifdef CH_MPI
+  MPI_Finalize();
+#endif
+  return status;
+}